@@ -0,0 +1,597 @@
+/*
+ * Out-of-core matrices for RedSVD
+ *
+ * Copyright (c) 2014 Nicolas Tessore
+ *
+ * based on RedSVD
+ *
+ * Copyright (c) 2010 Daisuke Okanohara
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above Copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above Copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the authors nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ */
+
+#ifndef REDSVD_MAPPED_MATRIX_H
+#define REDSVD_MAPPED_MATRIX_H
+
+#include "RedSVD.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace RedSVD
+{
+	// A matrix that lives in a file and is memory mapped read-only. The
+	// products with the solvers' dense blocks walk the file once in slices
+	// of at most blockBytes(), asking the kernel to read ahead the next
+	// slice and to drop the previous one, so the resident part of A stays
+	// bounded independently of its size.
+	//
+	// The file is a 64 byte header followed by 64 byte aligned sections:
+	// dense column-major values, or for compressed storage the outer
+	// offsets (int64), inner indices (StorageIndex) and values.
+	template<typename _Scalar, typename _StorageIndex = int>
+	class MappedMatrix
+	{
+	public:
+		typedef _Scalar Scalar;
+		typedef _StorageIndex StorageIndex;
+		typedef Eigen::Index Index;
+		typedef typename Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> DenseMatrix;
+		typedef typename Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowMajorMatrix;
+		
+		enum Layout
+		{
+			DenseColumnMajor = 0,
+			CompressedColumn = 1,
+			CompressedRow = 2
+		};
+		
+		MappedMatrix()
+		: m_data(0), m_size(0), m_layout(DenseColumnMajor), m_rows(0), m_cols(0), m_nonZeros(0),
+		  m_outer(0), m_inner(0), m_values(0), m_blockBytes(std::size_t(256) << 20), m_checked(0) {}
+		
+		explicit MappedMatrix(const std::string& path)
+		: m_data(0), m_size(0), m_layout(DenseColumnMajor), m_rows(0), m_cols(0), m_nonZeros(0),
+		  m_outer(0), m_inner(0), m_values(0), m_blockBytes(std::size_t(256) << 20), m_checked(0)
+		{
+			open(path);
+		}
+		
+		MappedMatrix(const MappedMatrix&) = delete;
+		MappedMatrix& operator=(const MappedMatrix&) = delete;
+		
+		~MappedMatrix()
+		{
+			close();
+		}
+		
+		void open(const std::string& path)
+		{
+			close();
+			
+			const int fd = ::open(path.c_str(), O_RDONLY);
+			if(fd < 0)
+				throw std::runtime_error("RedSVD::MappedMatrix: cannot open " + path);
+			
+			struct stat st;
+			if(::fstat(fd, &st) != 0 || std::size_t(st.st_size) < sizeof(Header))
+			{
+				::close(fd);
+				throw std::runtime_error("RedSVD::MappedMatrix: cannot read " + path);
+			}
+			
+			void* data = ::mmap(0, std::size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+			::close(fd);
+			if(data == MAP_FAILED)
+				throw std::runtime_error("RedSVD::MappedMatrix: cannot map " + path);
+			
+			m_data = static_cast<const char*>(data);
+			m_size = std::size_t(st.st_size);
+			
+			Header header;
+			std::memcpy(&header, m_data, sizeof(Header));
+			if(std::memcmp(header.magic, "REDSVDMM", 8) != 0 || header.version != FormatVersion || header.scalarSize != sizeof(Scalar)
+			   || header.indexSize != sizeof(StorageIndex) || header.layout > CompressedRow
+			   || header.rows < 0 || header.cols < 0 || header.nonZeros < 0)
+			{
+				close();
+				throw std::runtime_error("RedSVD::MappedMatrix: incompatible file " + path);
+			}
+			
+			m_layout = Layout(header.layout);
+			m_rows = Index(header.rows);
+			m_cols = Index(header.cols);
+			m_nonZeros = Index(header.nonZeros);
+			
+			// sizes the file cannot hold would overflow the offsets below
+			const bool oversized = (m_layout == DenseColumnMajor)
+				? (m_cols > 0 && std::size_t(m_rows) > m_size / sizeof(Scalar) / std::size_t(m_cols))
+				: (std::size_t(outerSize()) >= m_size / sizeof(std::int64_t) || std::size_t(m_nonZeros) > m_size / sizeof(StorageIndex));
+			if(oversized)
+			{
+				close();
+				throw std::runtime_error("RedSVD::MappedMatrix: truncated file " + path);
+			}
+			
+			std::size_t offset = sizeof(Header);
+			if(m_layout == DenseColumnMajor)
+			{
+				m_values = reinterpret_cast<const Scalar*>(m_data + offset);
+				offset += std::size_t(m_rows) * std::size_t(m_cols) * sizeof(Scalar);
+			}
+			else
+			{
+				m_outer = reinterpret_cast<const std::int64_t*>(m_data + offset);
+				offset = align(offset + std::size_t(outerSize() + 1) * sizeof(std::int64_t));
+				m_inner = reinterpret_cast<const StorageIndex*>(m_data + offset);
+				offset = align(offset + std::size_t(m_nonZeros) * sizeof(StorageIndex));
+				m_values = reinterpret_cast<const Scalar*>(m_data + offset);
+				offset += std::size_t(m_nonZeros) * sizeof(Scalar);
+			}
+			
+			if(offset > m_size)
+			{
+				close();
+				throw std::runtime_error("RedSVD::MappedMatrix: truncated file " + path);
+			}
+			
+			// the slices index the inner and value sections through the
+			// outer offsets, which must cover them exactly and in order
+			if(m_layout != DenseColumnMajor)
+			{
+				bool valid = (m_outer[0] == 0 && m_outer[outerSize()] == m_nonZeros);
+				for(Index i = 0; valid && i < outerSize(); ++i)
+					valid = (m_outer[i] <= m_outer[i + 1]);
+				if(!valid)
+				{
+					close();
+					throw std::runtime_error("RedSVD::MappedMatrix: corrupt outer offsets in " + path);
+				}
+			}
+			
+			// the inner indices are checked by the first product, slice by
+			// slice as it reads them, instead of in a pass of their own
+			m_checked = 0;
+		}
+		
+		void close()
+		{
+			if(m_data)
+				::munmap(const_cast<char*>(m_data), m_size);
+			m_data = 0;
+			m_size = 0;
+			m_rows = m_cols = m_nonZeros = 0;
+			m_outer = 0;
+			m_inner = 0;
+			m_values = 0;
+			m_checked = 0;
+		}
+		
+		bool isOpen() const { return m_data != 0; }
+		
+		Index rows() const { return m_rows; }
+		Index cols() const { return m_cols; }
+		Index nonZeros() const { return (m_layout == DenseColumnMajor) ? m_rows * m_cols : m_nonZeros; }
+		Layout layout() const { return m_layout; }
+		
+		// upper bound on the bytes of A touched per slice
+		std::size_t blockBytes() const { return m_blockBytes; }
+		void setBlockBytes(std::size_t bytes) { m_blockBytes = bytes; }
+		
+		template<typename Derived>
+		static void write(const std::string& path, const Eigen::DenseBase<Derived>& A)
+		{
+			std::ofstream out(path.c_str(), std::ios::binary);
+			writeHeader(out, DenseColumnMajor, A.rows(), A.cols(), A.rows() * A.cols());
+			for(Index j = 0; j < A.cols(); ++j)
+			{
+				const Eigen::Matrix<Scalar, Eigen::Dynamic, 1> col = A.col(j);
+				out.write(reinterpret_cast<const char*>(col.data()), std::streamsize(col.size() * sizeof(Scalar)));
+			}
+			if(!out)
+				throw std::runtime_error("RedSVD::MappedMatrix: cannot write " + path);
+		}
+		
+		template<int _Options>
+		static void write(const std::string& path, const Eigen::SparseMatrix<Scalar, _Options, StorageIndex>& A)
+		{
+			Eigen::SparseMatrix<Scalar, _Options, StorageIndex> C(A);
+			C.makeCompressed();
+			
+			std::ofstream out(path.c_str(), std::ios::binary);
+			std::size_t offset = writeHeader(out, (_Options & Eigen::RowMajor) ? CompressedRow : CompressedColumn, C.rows(), C.cols(), C.nonZeros());
+			
+			for(Index i = 0; i <= C.outerSize(); ++i)
+			{
+				const std::int64_t o = C.outerIndexPtr()[i];
+				out.write(reinterpret_cast<const char*>(&o), sizeof(o));
+			}
+			offset = pad(out, offset + std::size_t(C.outerSize() + 1) * sizeof(std::int64_t));
+			out.write(reinterpret_cast<const char*>(C.innerIndexPtr()), std::streamsize(C.nonZeros() * sizeof(StorageIndex)));
+			pad(out, offset + std::size_t(C.nonZeros()) * sizeof(StorageIndex));
+			out.write(reinterpret_cast<const char*>(C.valuePtr()), std::streamsize(C.nonZeros() * sizeof(Scalar)));
+			
+			if(!out)
+				throw std::runtime_error("RedSVD::MappedMatrix: cannot write " + path);
+		}
+		
+		// Y = A * X; throws std::runtime_error if the first product finds an
+		// inner index out of range
+		void multiply(const DenseMatrix& X, DenseMatrix& Y, int threads = Eigen::nbThreads()) const
+		{
+			switch(m_layout)
+			{
+			case DenseColumnMajor:
+				Y = DenseMatrix::Zero(m_rows, X.cols());
+				forEachSlice([&](Index begin, Index end)
+				{
+					Y.noalias() += denseSlice(begin, end) * X.middleRows(begin, end - begin);
+				});
+				break;
+			
+			case CompressedColumn:
+				compressedProduct(X, Y, m_rows, false, threads);
+				break;
+			
+			case CompressedRow:
+				compressedProduct(X, Y, m_rows, true, threads);
+				break;
+			}
+		}
+		
+		// Y = A^T * X
+		void multiply_adjoint(const DenseMatrix& X, DenseMatrix& Y, int threads = Eigen::nbThreads()) const
+		{
+			switch(m_layout)
+			{
+			case DenseColumnMajor:
+				Y.resize(m_cols, X.cols());
+				forEachSlice([&](Index begin, Index end)
+				{
+					Y.middleRows(begin, end - begin).noalias() = denseSlice(begin, end).transpose() * X;
+				});
+				break;
+			
+			case CompressedColumn:
+				compressedProduct(X, Y, m_cols, true, threads);
+				break;
+			
+			case CompressedRow:
+				compressedProduct(X, Y, m_cols, false, threads);
+				break;
+			}
+		}
+	
+	private:
+		enum { FormatVersion = 1 };
+		
+		struct Header
+		{
+			char magic[8];
+			std::uint32_t version;
+			std::uint32_t layout;
+			std::uint32_t scalarSize;
+			std::uint32_t indexSize;
+			std::int64_t rows;
+			std::int64_t cols;
+			std::int64_t nonZeros;
+			char reserved[16];
+		};
+		
+		static std::size_t align(std::size_t offset)
+		{
+			return (offset + 63) & ~std::size_t(63);
+		}
+		
+		static std::size_t pad(std::ofstream& out, std::size_t offset)
+		{
+			static const char zeros[64] = {0};
+			const std::size_t aligned = align(offset);
+			out.write(zeros, std::streamsize(aligned - offset));
+			return aligned;
+		}
+		
+		static std::size_t writeHeader(std::ofstream& out, Layout layout, Index rows, Index cols, Index nonZeros)
+		{
+			Header header;
+			std::memset(&header, 0, sizeof(Header));
+			std::memcpy(header.magic, "REDSVDMM", 8);
+			header.version = FormatVersion;
+			header.layout = std::uint32_t(layout);
+			header.scalarSize = sizeof(Scalar);
+			header.indexSize = sizeof(StorageIndex);
+			header.rows = rows;
+			header.cols = cols;
+			header.nonZeros = nonZeros;
+			out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+			return sizeof(Header);
+		}
+		
+		Index outerSize() const
+		{
+			return (m_layout == CompressedRow) ? m_rows : m_cols;
+		}
+		
+		Index innerSize() const
+		{
+			return (m_layout == CompressedRow) ? m_cols : m_rows;
+		}
+		
+		Eigen::Map<const DenseMatrix> denseSlice(Index begin, Index end) const
+		{
+			return Eigen::Map<const DenseMatrix>(m_values + begin * m_rows, m_rows, end - begin);
+		}
+		
+		// bytes of the file spanned by the outer vectors [begin, end)
+		void sliceRange(Index begin, Index end, std::vector<std::pair<const char*, std::size_t> >& ranges) const
+		{
+			ranges.clear();
+			if(m_layout == DenseColumnMajor)
+			{
+				ranges.push_back(std::make_pair(reinterpret_cast<const char*>(m_values + begin * m_rows), std::size_t(end - begin) * std::size_t(m_rows) * sizeof(Scalar)));
+				return;
+			}
+			ranges.push_back(std::make_pair(reinterpret_cast<const char*>(m_inner + m_outer[begin]), std::size_t(m_outer[end] - m_outer[begin]) * sizeof(StorageIndex)));
+			ranges.push_back(std::make_pair(reinterpret_cast<const char*>(m_values + m_outer[begin]), std::size_t(m_outer[end] - m_outer[begin]) * sizeof(Scalar)));
+		}
+		
+		void advise(Index begin, Index end, int advice) const
+		{
+			if(begin >= end)
+				return;
+			
+			const std::size_t page = std::size_t(::sysconf(_SC_PAGESIZE));
+			std::vector<std::pair<const char*, std::size_t> > ranges;
+			sliceRange(begin, end, ranges);
+			
+			for(std::size_t k = 0; k < ranges.size(); ++k)
+			{
+				std::size_t first = std::size_t(ranges[k].first - m_data);
+				std::size_t last = first + ranges[k].second;
+				
+				// pages to read ahead are rounded outwards, pages to drop
+				// inwards so that neighbouring slices are not evicted
+				if(advice == MADV_WILLNEED)
+				{
+					first = first / page * page;
+					last = (last + page - 1) / page * page;
+				}
+				else
+				{
+					first = (first + page - 1) / page * page;
+					last = last / page * page;
+				}
+				last = (last < m_size) ? last : m_size;
+				
+				if(first < last)
+					::madvise(const_cast<char*>(m_data) + first, last - first, advice);
+			}
+		}
+		
+		// calls f(begin, end) for consecutive slices of outer vectors
+		template<typename Function>
+		void forEachSlice(Function f) const
+		{
+			const Index outer = (m_layout == DenseColumnMajor) ? m_cols : outerSize();
+			const std::size_t bytesPerEntry = (m_layout == DenseColumnMajor) ? sizeof(Scalar) : sizeof(Scalar) + sizeof(StorageIndex);
+			
+			std::vector<Index> bounds(1, 0);
+			std::size_t bytes = 0;
+			for(Index j = 0; j < outer; ++j)
+			{
+				const std::size_t entries = (m_layout == DenseColumnMajor) ? std::size_t(m_rows) : std::size_t(m_outer[j+1] - m_outer[j]);
+				if(bytes > 0 && bytes + entries * bytesPerEntry > m_blockBytes)
+				{
+					bounds.push_back(j);
+					bytes = 0;
+				}
+				bytes += entries * bytesPerEntry;
+			}
+			if(bounds.back() != outer)
+				bounds.push_back(outer);
+			
+			for(std::size_t b = 0; b + 1 < bounds.size(); ++b)
+			{
+				if(b + 2 < bounds.size())
+					advise(bounds[b+1], bounds[b+2], MADV_WILLNEED);
+				else if(b == 0)
+					advise(bounds[b], bounds[b+1], MADV_WILLNEED);
+				
+				f(bounds[b], bounds[b+1]);
+				
+				advise(bounds[b], bounds[b+1], MADV_DONTNEED);
+			}
+		}
+		
+		// Y = A X or A^T X for compressed storage with rows of the result,
+		// gathered over the outer vectors if they are the rows of Y and
+		// scattered from them otherwise. Both work on row-major copies of X
+		// and Y, so every nonzero updates all right-hand sides at once, as
+		// for the in-memory sparse matrices.
+		void compressedProduct(const DenseMatrix& X, DenseMatrix& Y, Index rows, bool rowsAreOuter, int threads) const
+		{
+			const RowMajorMatrix Xr = X;
+			RowMajorMatrix Yr = RowMajorMatrix::Zero(rows, X.cols());
+			
+			if(rowsAreOuter)
+			{
+				forEachSlice([&](Index begin, Index end)
+				{
+					check(begin, end);
+					gather(begin, end, Xr, Yr, threads);
+				});
+			}
+			else
+			{
+				// as for sparse_scatter, every thread sums its share of each slice
+				// into its own copy of Y, added up once after the last slice
+				const Index inner = innerSize();
+				Index parts = (inner > 0) ? m_nonZeros / inner : 1;
+				parts = (parts < threads) ? parts : threads;
+				parts = (parts > 1) ? parts : 1;
+				
+				std::vector<RowMajorMatrix> partial(parts - 1, RowMajorMatrix::Zero(rows, X.cols()));
+				forEachSlice([&](Index begin, Index end)
+				{
+					check(begin, end);
+					scatter(begin, end, Xr, Yr, partial);
+				});
+				
+				if(parts > 1)
+				{
+#ifdef EIGEN_HAS_OPENMP
+					#pragma omp parallel for num_threads(parts) schedule(static)
+#endif
+					for(Index i = 0; i < rows; ++i)
+					{
+						for(Index t = 1; t < parts; ++t)
+							Yr.row(i) += partial[t - 1].row(i);
+					}
+				}
+			}
+			
+			Y = Yr;
+		}
+		
+		// the kernels index the dense operands with the inner indices without
+		// bounds checks, so the outer vectors [begin, end) are checked unless
+		// a previous product already did; products run in order from the
+		// first slice, so the checked ones are a prefix
+		void check(Index begin, Index end) const
+		{
+			if(end <= m_checked)
+				return;
+			
+			const Index inner = innerSize();
+			for(std::int64_t p = m_outer[(begin > m_checked) ? begin : m_checked]; p < m_outer[end]; ++p)
+			{
+				if(m_inner[p] < 0 || Index(m_inner[p]) >= inner)
+					throw std::runtime_error("RedSVD::MappedMatrix: corrupt inner indices");
+			}
+			if(begin <= m_checked)
+				m_checked = end;
+		}
+		
+		// Y.row(j) += sum_k A_jk X.row(k) over outer vectors j, in parallel;
+		// a single right-hand side is summed in a scalar, which the row
+		// expressions are several times slower than
+		void gather(Index begin, Index end, const RowMajorMatrix& X, RowMajorMatrix& Y, int threads) const
+		{
+			const bool single = (X.cols() == 1);
+			
+			EIGEN_UNUSED_VARIABLE(threads);
+#ifdef EIGEN_HAS_OPENMP
+			#pragma omp parallel for num_threads(threads) schedule(dynamic, 256)
+#endif
+			for(Index j = begin; j < end; ++j)
+			{
+				if(single)
+				{
+					Scalar sum = 0;
+					for(std::int64_t p = m_outer[j]; p < m_outer[j+1]; ++p)
+						sum += m_values[p] * X(m_inner[p], 0);
+					Y(j, 0) += sum;
+				}
+				else
+				{
+					for(std::int64_t p = m_outer[j]; p < m_outer[j+1]; ++p)
+						Y.row(j) += m_values[p] * X.row(m_inner[p]);
+				}
+			}
+		}
+		
+		// Y.row(k) += A_jk X.row(j) over outer vectors j; the slice is split
+		// between Y and the partial sums into ranges of about the same
+		// number of nonzeros, one per thread
+		void scatter(Index begin, Index end, const RowMajorMatrix& X, RowMajorMatrix& Y, std::vector<RowMajorMatrix>& partial) const
+		{
+			const Index parts = Index(partial.size()) + 1;
+			const std::int64_t first = m_outer[begin];
+			const std::int64_t count = m_outer[end] - first;
+			
+			std::vector<Index> bounds(parts + 1, end);
+			bounds[0] = begin;
+			for(Index t = 1, j = begin; t < parts; ++t)
+			{
+				while(j < end && m_outer[j] - first < count * t / parts)
+					++j;
+				bounds[t] = j;
+			}
+			
+#ifdef EIGEN_HAS_OPENMP
+			#pragma omp parallel for num_threads(parts) schedule(static, 1)
+#endif
+			for(Index t = 0; t < parts; ++t)
+			{
+				RowMajorMatrix& P = (t == 0) ? Y : partial[t - 1];
+				for(Index j = bounds[t]; j < bounds[t + 1]; ++j)
+				{
+					if(X.cols() == 1)
+					{
+						const Scalar x = X(j, 0);
+						for(std::int64_t p = m_outer[j]; p < m_outer[j+1]; ++p)
+							P(m_inner[p], 0) += m_values[p] * x;
+					}
+					else
+					{
+						for(std::int64_t p = m_outer[j]; p < m_outer[j+1]; ++p)
+							P.row(m_inner[p]) += m_values[p] * X.row(j);
+					}
+				}
+			}
+		}
+		
+		const char* m_data;
+		std::size_t m_size;
+		Layout m_layout;
+		Index m_rows;
+		Index m_cols;
+		Index m_nonZeros;
+		const std::int64_t* m_outer;
+		const StorageIndex* m_inner;
+		const Scalar* m_values;
+		std::size_t m_blockBytes;
+		// leading outer vectors whose inner indices a product has checked
+		mutable Index m_checked;
+	};
+	
+	template<typename Scalar, typename StorageIndex, typename DenseMatrix>
+	inline void multiply(const MappedMatrix<Scalar, StorageIndex>& A, const DenseMatrix& X, DenseMatrix& Y, const Options& options)
+	{
+		A.multiply(X, Y, options.threads());
+	}
+	
+	template<typename Scalar, typename StorageIndex, typename DenseMatrix>
+	inline void multiply_adjoint(const MappedMatrix<Scalar, StorageIndex>& A, const DenseMatrix& X, DenseMatrix& Y, const Options& options)
+	{
+		A.multiply_adjoint(X, Y, options.threads());
+	}
+	
+	template<typename Scalar, typename StorageIndex>
+	inline bool out_of_core(const MappedMatrix<Scalar, StorageIndex>&)
+	{
+		return true;
+	}
+}
+
+#endif